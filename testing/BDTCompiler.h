@@ -0,0 +1,211 @@
+/*
+Flattened evaluator for the TMVA BDT weights files.
+
+The forest in the weights XML is compiled into one contiguous array of small nodes (cut value, input
+variable and the two child indices), each tree stored breadth first so that its top levels share a
+few cache lines. The cut type is folded in by swapping the children, so every node goes to
+child[x >= cut], and the leaves point to themselves, so that a tree is walked with a fixed number of
+steps (its depth) and no leaf test. The leaf values are kept apart, already multiplied by the boost
+weight of their tree.
+
+The events are scored in blocks of kBlock, tree by tree and level by level over the block, reading
+the inputs directly from the columns of the feature cache; the independent walks of the events of a
+block hide the latency of the node loads.
+
+The scores are the same as TMVA::Reader::EvaluateMVA: the inputs are compared in single precision
+as in DecisionTreeNode::GoesRight, and the tree responses are summed in double precision in tree
+order, as in MethodBDT::GetMvaValue. AdaBoost and Bagging (boost-weighted average of the leaf type
+or purity) and Grad (2 / (1 + exp(-2 * sum)) - 1) forests are supported; Fisher cuts and
+preselection cuts are not.
+
+Evaluate() only uses local buffers, so one evaluator can be shared by several threads.
+*/
+
+#ifndef BDTCOMPILER_H
+#define BDTCOMPILER_H
+
+#include <vector>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <algorithm>
+#include "TString.h"
+
+#include "TMVAWeights.h"
+
+
+class BDTCompiler {
+
+public:
+  static const Int_t kBlock = 64;     // events per block
+
+  // Parse and compile the weights file. Returns kFALSE (and prints why) if it cannot be used.
+  Bool_t Load(const TString &file){
+    TMVAWeights weights;
+    if(!weights.Load(file)) return kFALSE;
+    if(!weights.GetMethod().BeginsWith("BDT")){
+      std::cout << "ERROR: " << file << " is not a BDT weights file" << std::endl;
+      return kFALSE;
+    }
+    if(weights.GetAnalysisType() == "Regression" || weights.GetAnalysisType() == "Multiclass"){
+      std::cout << "ERROR: only classification BDTs are supported" << std::endl;
+      return kFALSE;
+    }
+    TString boost = weights.GetOption("BoostType", "AdaBoost");
+    if(boost != "AdaBoost" && boost != "Bagging" && boost != "Grad"){
+      std::cout << "ERROR: unsupported boost type " << boost << std::endl;
+      return kFALSE;
+    }
+    if(IsTrue(weights.GetOption("UseFisherCuts", "False")) || IsTrue(weights.GetOption("DoPreselection", "False"))){
+      std::cout << "ERROR: Fisher cuts and preselection cuts are not supported" << std::endl;
+      return kFALSE;
+    }
+    fGrad = (boost == "Grad");
+    Bool_t yesNoLeaf = IsTrue(weights.GetOption("UseYesNoLeaf", "True"));
+
+    fVariables = weights.GetVariables();
+    Int_t nVar = (Int_t)fVariables.size();
+    fNormalize = weights.HasNormalize();
+    fMin.clear();
+    fScale.clear();
+    for(int i = 0; i < nVar && fNormalize; i++){
+      fMin.push_back(weights.GetMin(i));
+      fScale.push_back(weights.GetScale(i));
+    }
+
+    TXMLEngine &xml = weights.Engine();
+    fNodes.clear();
+    fLeaf.clear();
+    fRoot.clear();
+    fDepth.clear();
+    fNorm = 0;
+    for(XMLNodePointer_t tree = weights.Child(weights.GetWeightsNode(), "BinaryTree"); tree; tree = xml.GetNext(tree)){
+      if(TString(xml.GetNodeName(tree)) != "BinaryTree") continue;
+      Double_t boostWeight = weights.Attr(tree, "boostWeight").Atof();
+      fNorm += boostWeight;
+      Int_t root = (Int_t)fNodes.size();
+      Int_t depth = 0;
+
+      // breadth first: the children of a node are appended when the node is compiled
+      std::vector<XMLNodePointer_t> queue(1, weights.Child(tree, "Node"));
+      std::vector<Int_t> level(1, 0);
+      fNodes.push_back(Node());
+      fLeaf.push_back(0);
+      for(size_t q = 0; q < queue.size(); q++){
+        XMLNodePointer_t xnode = queue[q];
+        Int_t self = root + (Int_t)q;
+        Node &n = fNodes[self];
+        if(!xnode || weights.Attr(xnode, "NCoef").Atoi() > 0){
+          std::cout << "ERROR: missing node or Fisher cut in " << file << std::endl;
+          return kFALSE;
+        }
+
+        // as in DecisionTree::CheckEvent, the walk stops at the first node with a type
+        if(weights.Attr(xnode, "nType").Atoi() != 0){
+          n.var = 0;
+          n.cut = 0;
+          n.child[0] = n.child[1] = self;
+          Double_t value = fGrad ? (Double_t)(Float_t)weights.Attr(xnode, "res").Atof()
+            : (yesNoLeaf ? (Double_t)weights.Attr(xnode, "nType").Atoi() : (Double_t)(Float_t)weights.Attr(xnode, "purity").Atof());
+          fLeaf[self] = fGrad ? value : boostWeight * value;
+          depth = std::max(depth, level[q]);
+          continue;
+        }
+
+        XMLNodePointer_t left = 0, right = 0;
+        for(XMLNodePointer_t c = weights.Child(xnode, "Node"); c; c = xml.GetNext(c)){
+          if(weights.Attr(c, "pos") == "l") left = c;
+          if(weights.Attr(c, "pos") == "r") right = c;
+        }
+        n.var = weights.Attr(xnode, "IVar").Atoi();
+        n.cut = (Float_t)weights.Attr(xnode, "Cut").Atof();
+        if(n.var < 0 || n.var >= nVar){
+          std::cout << "ERROR: bad input variable index in " << file << std::endl;
+          return kFALSE;
+        }
+        // cType 1: right if x >= cut, cType 0: right if !(x >= cut)
+        Bool_t rightIfAbove = (weights.Attr(xnode, "cType").Atoi() == 1);
+        n.child[0] = root + (Int_t)queue.size() + (rightIfAbove ? 0 : 1);
+        n.child[1] = root + (Int_t)queue.size() + (rightIfAbove ? 1 : 0);
+        queue.push_back(left);
+        queue.push_back(right);
+        level.push_back(level[q] + 1);
+        level.push_back(level[q] + 1);
+        fNodes.resize(root + queue.size());    // invalidates n
+        fLeaf.resize(root + queue.size(), 0);
+      }
+      fRoot.push_back(root);
+      fDepth.push_back(depth);
+    }
+    if(fRoot.empty()){
+      std::cout << "ERROR: no trees in " << file << std::endl;
+      return kFALSE;
+    }
+    std::cout << "--- BDTCompiler: " << fRoot.size() << " trees, " << fNodes.size() << " nodes from " << file << std::endl;
+    return kTRUE;
+  }
+
+  // Expressions of the input variables, in the order Evaluate() expects the columns
+  const std::vector<TString> &GetVariables() const { return fVariables; }
+  Int_t GetNTrees() const { return (Int_t)fRoot.size(); }
+
+  // Score n events: variable i of event e is cols[i][first + e], the score goes to out[e]
+  void Evaluate(const Float_t *const *cols, Long64_t first, Long64_t n, Double_t *out) const {
+    Int_t nVar = (Int_t)fVariables.size();
+    std::vector<Float_t> in(nVar * kBlock);
+    std::vector<Int_t> idx(kBlock);
+    std::vector<Double_t> sum(kBlock);
+
+    for(Long64_t start = 0; start < n; start += kBlock){
+      Int_t nb = (n - start < kBlock) ? (Int_t)(n - start) : kBlock;
+
+      // inputs, one row of kBlock events per variable, normalised as in the TMVA transformation
+      for(int i = 0; i < nVar; i++){
+        const Float_t *col = cols[i] + first + start;
+        Float_t *row = &in[i * kBlock];
+        if(fNormalize) for(int e = 0; e < nb; e++) row[e] = (col[e] - fMin[i]) * fScale[i] * 2 - 1;
+        else           for(int e = 0; e < nb; e++) row[e] = col[e];
+      }
+
+      for(int e = 0; e < nb; e++) sum[e] = 0;
+      for(size_t t = 0; t < fRoot.size(); t++){
+        for(int e = 0; e < nb; e++) idx[e] = fRoot[t];
+        for(int d = 0; d < fDepth[t]; d++){
+          for(int e = 0; e < nb; e++){
+            const Node &node = fNodes[idx[e]];
+            idx[e] = node.child[in[node.var * kBlock + e] >= node.cut];
+          }
+        }
+        for(int e = 0; e < nb; e++) sum[e] += fLeaf[idx[e]];
+      }
+
+      for(int e = 0; e < nb; e++){
+        if(fGrad) out[start + e] = 2.0 / (1.0 + exp(-2.0 * sum[e])) - 1;
+        else      out[start + e] = (fNorm > std::numeric_limits<double>::epsilon()) ? sum[e] / fNorm : 0;
+      }
+    }
+  }
+
+private:
+  struct Node {
+    Float_t cut;
+    Int_t var;
+    Int_t child[2];      // child[x >= cut]; a leaf points to itself
+  };
+
+  static Bool_t IsTrue(TString value){
+    value.ToLower();
+    return value == "true" || value == "t" || value == "1";
+  }
+
+  std::vector<TString> fVariables;
+  Bool_t fNormalize;
+  std::vector<Float_t> fMin, fScale;
+  Bool_t fGrad;
+  std::vector<Node> fNodes;         // all the trees, one after the other
+  std::vector<Double_t> fLeaf;      // boost weight * leaf value (leaf response for Grad), per node
+  std::vector<Int_t> fRoot, fDepth; // per tree
+  Double_t fNorm;                   // sum of the boost weights
+};
+
+#endif
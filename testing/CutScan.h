@@ -0,0 +1,219 @@
+/*
+Cut scanner shared by the scan and classification macros.
+
+Instead of testing every event against every cut value, each event is dropped into the slot of the
+(ascending) cut grid it falls into with a binary search, and the S and B counts for every cut are
+obtained afterwards from cumulative sums. This makes a scan O(events * log(cuts) + cuts) instead of
+O(events * cuts), and the counts are exactly the ones of the old event-by-cut loop.
+
+Two selection directions are supported:
+  kBelow : the event passes the cut if value < cut  (e.g. chisq4C)
+  kAbove : the event passes the cut if value > cut  (e.g. ANN/BDT score)
+
+If the raw values are kept, the exact optimal threshold (not limited to the cut grid) can also be
+found by sorting the values once and sweeping over them. A caller that has the values in arrays
+already (like the MVA scores in cl.C, or the float columns of the feature cache) can pass them to
+FindExactBest instead of keeping a copy; the values are then sorted in their own precision.
+
+The per-slot counts can be written to a ROOT file and added back from it, so that the events can be
+scanned in separate jobs and the partial results merged (see Partial.h). The raw values are not
+written, so the exact optimum is only available in the job that saw the events.
+*/
+
+#ifndef CUTSCAN_H
+#define CUTSCAN_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "RtypesCore.h"
+#include "TString.h"
+#include "TDirectory.h"
+#include "TVectorD.h"
+
+
+class CutScan {
+
+public:
+  enum Direction { kBelow, kAbove };
+
+  // The cut values must be sorted in ascending order (as the cut arrays in the macros are)
+  CutScan(const Double_t *cuts, Int_t nCuts, Direction dir, Bool_t keepValues = kFALSE)
+    : fCuts(cuts, cuts + nCuts), fDir(dir), fKeep(keepValues),
+      fSlotS(nCuts + 1, 0), fSlotB(nCuts + 1, 0), fS(nCuts, 0), fB(nCuts, 0), fTotS(0), fTotB(0) {}
+
+  // Add one event; signal is the mcSignal label (1 = signal, 0 = background, anything else is ignored)
+  void Fill(Double_t value, Int_t signal){
+    if(signal != 0 && signal != 1) return;
+    Int_t k = Slot(value);
+    if(signal == 1){ fSlotS[k]++; fTotS++; }
+    else           { fSlotB[k]++; fTotB++; }
+    if(fKeep && !std::isnan(value)) fValues.push_back(Entry<Double_t>{value, signal});
+  }
+
+  // Add the events of another scanner on the same cut grid (e.g. from another thread or job)
+  void Add(const CutScan &other){
+    for(size_t k = 0; k < fSlotS.size(); k++){
+      fSlotS[k] += other.fSlotS[k];
+      fSlotB[k] += other.fSlotB[k];
+    }
+    fTotS += other.fTotS;
+    fTotB += other.fTotB;
+    if(fKeep) fValues.insert(fValues.end(), other.fValues.begin(), other.fValues.end());
+  }
+
+  // Write the cut grid and the per-slot counts to the current directory as name_grid and name_counts.
+  // Call before Finalize().
+  void Write(const char *name) const {
+    Int_t n = GetNCuts();
+    TVectorD grid(n + 1), counts(2 * (n + 1) + 2);
+    grid[0] = fDir;
+    for(int i = 0; i < n; i++) grid[i + 1] = fCuts[i];
+    for(int k = 0; k <= n; k++){
+      counts[k] = fSlotS[k];
+      counts[n + 1 + k] = fSlotB[k];
+    }
+    counts[2 * (n + 1)] = fTotS;
+    counts[2 * (n + 1) + 1] = fTotB;
+    grid.Write(TString(name) + "_grid");
+    counts.Write(TString(name) + "_counts");
+  }
+
+  // Add the counts written by Write() under name in dir. Returns kFALSE if they are missing or
+  // were made on a different cut grid. Call before Finalize().
+  Bool_t Read(TDirectory *dir, const char *name){
+    Int_t n = GetNCuts();
+    TVectorD *grid = (TVectorD*)dir -> Get(TString(name) + "_grid");
+    TVectorD *counts = (TVectorD*)dir -> Get(TString(name) + "_counts");
+    Bool_t ok = grid && counts && grid -> GetNrows() == n + 1 && counts -> GetNrows() == 2 * (n + 1) + 2 && (*grid)[0] == fDir;
+    for(int i = 0; ok && i < n; i++) ok = ((*grid)[i + 1] == fCuts[i]);
+    for(int k = 0; ok && k <= n; k++){
+      fSlotS[k] += (Long64_t)(*counts)[k];
+      fSlotB[k] += (Long64_t)(*counts)[n + 1 + k];
+    }
+    if(ok){
+      fTotS += (Long64_t)(*counts)[2 * (n + 1)];
+      fTotB += (Long64_t)(*counts)[2 * (n + 1) + 1];
+    }
+    delete grid;
+    delete counts;
+    return ok;
+  }
+
+  // Turn the per-slot counts into the S and B counts for each cut. Call once after the event loop.
+  void Finalize(){
+    Int_t n = GetNCuts();
+    Long64_t s = 0, b = 0;
+    if(fDir == kBelow){        // passes for all cuts i >= slot
+      for(int i = 0; i < n; i++){
+        s += fSlotS[i]; b += fSlotB[i];
+        fS[i] = s; fB[i] = b;
+      }
+    }
+    else{                      // passes for all cuts i < slot
+      for(int i = n - 1; i >= 0; i--){
+        s += fSlotS[i + 1]; b += fSlotB[i + 1];
+        fS[i] = s; fB[i] = b;
+      }
+    }
+  }
+
+  Int_t     GetNCuts() const { return (Int_t)fCuts.size(); }
+  Double_t  GetCut(Int_t i) const { return fCuts[i]; }
+  Long64_t  GetS(Int_t i) const { return fS[i]; }     // signal events passing cut i (true positives)
+  Long64_t  GetB(Int_t i) const { return fB[i]; }     // background events passing cut i (false positives)
+  Long64_t  GetTotS() const { return fTotS; }
+  Long64_t  GetTotB() const { return fTotB; }
+
+  Double_t GetSignificance(Int_t i) const { return Significance(fS[i], fB[i]); }
+  Double_t GetSoverB(Int_t i) const { return (Double_t)fS[i] / (Double_t)fB[i]; }
+  Double_t GetSigEff(Int_t i) const { return (Double_t)fS[i] / (Double_t)fTotS; }
+  Double_t GetBkgRej(Int_t i) const { return (Double_t)(fTotB - fB[i]) / (Double_t)fTotB; }
+
+  // Index of the cut with the highest significance. NaN values (empty selections) are skipped.
+  // On ties the first cut is returned, or the last one if lastOfTies is set.
+  Int_t BestIndex(Bool_t lastOfTies = kFALSE) const {
+    Int_t best = 0;
+    Double_t bestS = -1;
+    for(int i = 0; i < GetNCuts(); i++){
+      Double_t sig = GetSignificance(i);
+      if(std::isnan(sig)) continue;
+      if(sig > bestS || (lastOfTies && sig == bestS)){
+        bestS = sig;
+        best = i;
+      }
+    }
+    return best;
+  }
+
+  // Exact optimal threshold from the sorted event values (needs keepValues). The returned cut lies
+  // half way between the last accepted and the first rejected value. Returns kFALSE if no values were kept.
+  Bool_t FindExactBest(Double_t &bestCut, Long64_t &bestS, Long64_t &bestB) const {
+    std::vector<Entry<Double_t>> v(fValues);
+    return Sweep(v, bestCut, bestS, bestB);
+  }
+
+  // The same for the n events of the given value (Double_t or Float_t) and mcSignal label arrays,
+  // without keepValues
+  template<class T>
+  Bool_t FindExactBest(const T *values, const Char_t *signals, Long64_t n,
+                       Double_t &bestCut, Long64_t &bestS, Long64_t &bestB) const {
+    std::vector<Entry<T>> v;
+    v.reserve(n);
+    for(Long64_t i = 0; i < n; i++){
+      if((signals[i] == 0 || signals[i] == 1) && !std::isnan(values[i])) v.push_back(Entry<T>{values[i], signals[i]});
+    }
+    return Sweep(v, bestCut, bestS, bestB);
+  }
+
+  static Double_t Significance(Long64_t s, Long64_t b){ return (Double_t)s / sqrt((Double_t)(s + b)); }
+
+private:
+  template<class T> struct Entry { T value; Int_t signal; };
+
+  // Sort the values in the order the cut accepts them and sweep over them
+  template<class T>
+  Bool_t Sweep(std::vector<Entry<T>> &v, Double_t &bestCut, Long64_t &bestS, Long64_t &bestB) const {
+    if(v.empty()) return kFALSE;
+    if(fDir == kBelow) std::sort(v.begin(), v.end(), [](const Entry<T> &a, const Entry<T> &b){ return a.value < b.value; });
+    else               std::sort(v.begin(), v.end(), [](const Entry<T> &a, const Entry<T> &b){ return a.value > b.value; });
+    const Double_t edge = (fDir == kBelow) ? std::numeric_limits<Double_t>::infinity() : -std::numeric_limits<Double_t>::infinity();
+
+    Long64_t s = 0, b = 0;
+    Double_t best = -1;
+    size_t i = 0;
+    while(i < v.size()){
+      // accept the whole group of equal values at once
+      T value = v[i].value;
+      for(; i < v.size() && v[i].value == value; i++){
+        if(v[i].signal == 1) s++;
+        else b++;
+      }
+      Double_t sig = Significance(s, b);
+      if(sig > best){
+        best = sig;
+        bestS = s;
+        bestB = b;
+        bestCut = (i < v.size()) ? 0.5 * ((Double_t)value + v[i].value) : std::nextafter((Double_t)value, edge);
+      }
+    }
+    return kTRUE;
+  }
+
+  // Slot of the cut grid the value falls into (0..nCuts), see Finalize() for how it is used
+  Int_t Slot(Double_t value) const {
+    if(fDir == kBelow) return (Int_t)(std::upper_bound(fCuts.begin(), fCuts.end(), value) - fCuts.begin());
+    return (Int_t)(std::lower_bound(fCuts.begin(), fCuts.end(), value) - fCuts.begin());
+  }
+
+  std::vector<Double_t> fCuts;
+  Direction fDir;
+  Bool_t fKeep;
+  std::vector<Long64_t> fSlotS, fSlotB;   // events per slot of the cut grid
+  std::vector<Long64_t> fS, fB;           // cumulative counts per cut
+  Long64_t fTotS, fTotB;
+  std::vector<Entry<Double_t>> fValues;             // raw values for the exact optimisation
+};
+
+#endif
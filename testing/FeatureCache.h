@@ -0,0 +1,401 @@
+/*
+Columnar feature cache for the ntp1 tree.
+
+The branches a macro needs are extracted once from the ROOT file into a flat structure-of-arrays file
+(float32, or int8 for the integer ones like mcSignal, which are asked for as "mcSignal/B"). Later runs, and
+every pass of the same run, memory-map that file and read the columns directly, without going through
+TTree::GetEntry and the ROOT decompression again.
+
+The cache is tied to the identity of the input file (path, size and modification time) and is rebuilt
+automatically when the input changes or when a macro asks for a column the cache does not have yet
+(the existing columns are kept, so the macros can share one cache). A cache file (*.fcache) can also
+be given directly as the input of a macro.
+
+Note that the TMVA readers are fed Float_t anyway, so float32 loses nothing for the classification;
+sqrt_s and chisq4C are also compared as Float_t in the scan macros.
+
+Derived columns (e.g. the kinematic quantities of Kinematics.h) can be added in memory with AddFloat()
+and are then read like the stored ones. Only the entries a job fills take memory.
+
+The same file format (with Double_t columns) is used for the MVA score sidecars, see ScoreCache.h.
+*/
+
+#ifndef FEATURECACHE_H
+#define FEATURECACHE_H
+
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TBranch.h"
+#include "TLeaf.h"
+#include "TString.h"
+#include "TSystem.h"
+
+
+class FeatureCache {
+
+public:
+  enum EType { kFloat = 0, kInt8 = 1, kDouble = 2 };
+
+  FeatureCache() : fData(0), fSize(0), fEntries(0) {}
+  ~FeatureCache(){ Close(); }
+
+  // Open the cache of the given input file with (at least) the given columns ("name" for a float
+  // column, "name/B" for an int8 one), building or rebuilding it from the ntp1 tree if needed. By default the cache lives in the working
+  // directory, named after the input file. Returns kFALSE (and prints why) on failure.
+  Bool_t Open(const TString &input, const std::vector<TString> &columns, TString cacheFile = ""){
+    Close();
+    if(input.EndsWith(".fcache")){
+      if(!Map(input)) return kFALSE;
+      return HasColumns(columns, kTRUE);
+    }
+
+    if(cacheFile == "") cacheFile = DefaultPath(input);
+    TString key = InputKey(input);
+    if(key == ""){
+      std::cout << "ERROR: could not access input file " << input << std::endl;
+      return kFALSE;
+    }
+
+    std::vector<TString> toBuild(columns);
+    if(Map(cacheFile)){
+      if(fKey == key){
+        if(HasColumns(columns, kFALSE)) return kTRUE;
+        KeepColumns(toBuild);
+      }
+      else std::cout << "--- FeatureCache: " << cacheFile << " is stale, rebuilding" << std::endl;
+      Close();
+    }
+
+    // Several jobs can build the same cache at once (e.g. map jobs over entry ranges of one input).
+    // Each writes its own temporary file and the last one moved in place wins, so a job whose columns
+    // are not in the winner's file builds again with the columns of both.
+    for(int attempt = 0; attempt < 3; attempt++){
+      Bool_t built = Build(input, key, toBuild, cacheFile);
+      if(Map(cacheFile)){
+        if(fKey == key && HasColumns(columns, kFALSE)) return kTRUE;
+        if(fKey == key) KeepColumns(toBuild);
+        Close();
+      }
+      if(!built) return kFALSE;
+      std::cout << "--- FeatureCache: " << cacheFile << " was replaced by another job, rebuilding" << std::endl;
+    }
+    std::cout << "ERROR: could not build the feature cache " << cacheFile << std::endl;
+    return kFALSE;
+  }
+
+  void Close(){
+    if(fData) munmap(fData, fSize);
+    fData = 0;
+    fSize = 0;
+    fEntries = 0;
+    fColumns.clear();
+    for(auto &d : fDerived) munmap(d.data, d.size);
+    fDerived.clear();
+    fKey = "";
+  }
+
+  Long64_t GetEntries() const { return fEntries; }
+
+  // Zero-copy access to a column, 0 if it is not in the cache or has another type
+  const Float_t *GetFloat(const char *name) const { return (const Float_t*)Column(name, kFloat); }
+  const Char_t  *GetInt8(const char *name) const  { return (const Char_t*)Column(name, kInt8); }
+  const Double_t *GetDouble(const char *name) const { return (const Double_t*)Column(name, kDouble); }
+
+  // Add a float column computed in memory (e.g. a kinematic quantity, see Kinematics.h) and return it
+  // to be filled, 0 on failure. It is indexed by entry like the stored columns and GetFloat() returns
+  // it like them, but it is not written to the cache file. Its pages are mapped on first use, so a job
+  // over a range of entries only uses memory for the entries it fills; the others read as 0.
+  Float_t *AddFloat(const char *name){
+    size_t size = (fEntries > 0 ? fEntries : 1) * sizeof(Float_t);
+    void *data = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(data == MAP_FAILED){
+      std::cout << "ERROR: could not allocate column " << name << std::endl;
+      return 0;
+    }
+    fDerived.push_back(Derived{name, (Float_t*)data, size});
+    return (Float_t*)data;
+  }
+
+  // Cache file used by default for an input file, in the working directory. The name has a hash of the
+  // full path of the input, so that inputs with the same name in different directories do not share it.
+  static TString DefaultPath(const TString &input){ return TString("./") + gSystem->BaseName(input) + "." + PathHash(input) + ".fcache"; }
+
+  // Short hash of the full path of a file (with the links resolved if it exists)
+  static TString PathHash(const TString &input){
+    TString path = input;
+    gSystem->ExpandPathName(path);
+    char *real = realpath(path, 0);
+    if(real){
+      path = real;
+      free(real);
+    }
+    return TString::Format("%08x", path.Hash());
+  }
+
+  // Identity of the input file the cache was built from
+  static TString InputKey(const TString &input){
+    FileStat_t st;
+    if(gSystem->GetPathInfo(input, st) != 0) return "";
+    TString path = input;
+    gSystem->ExpandPathName(path);
+    return TString::Format("%s:%lld:%ld", path.Data(), st.fSize, st.fMtime);
+  }
+
+  // Extract the columns from the ntp1 tree of the input file and write them to the cache file
+  static Bool_t Build(const TString &input, const TString &key, const std::vector<TString> &columns, const TString &cacheFile){
+    std::cout << "--- FeatureCache: building " << cacheFile << " from " << input << std::endl;
+    TFile *file = TFile::Open(input);
+    if(!file || file->IsZombie()){
+      std::cout << "ERROR: could not open data file " << input << std::endl;
+      return kFALSE;
+    }
+    TTree *tree = (TTree*)file->Get("ntp1");
+    if(!tree){
+      std::cout << "ERROR: no ntp1 tree in " << input << std::endl;
+      delete file;
+      return kFALSE;
+    }
+
+    Long64_t n = tree->GetEntries();
+    Int_t nCol = (Int_t)columns.size();
+    std::vector<TString> names(nCol);
+    std::vector<Int_t> types(nCol);
+    for(int i = 0; i < nCol; i++) ParseColumn(columns[i], names[i], types[i]);
+    std::vector<TString> leafTypes(nCol);
+    std::vector<Double_t> dbuf(nCol);
+    std::vector<Float_t> fbuf(nCol);
+    std::vector<Int_t> ibuf(nCol);
+    std::vector<std::vector<Float_t> > fcol(nCol);
+    std::vector<std::vector<Char_t> > icol(nCol);
+
+    // only read the branches that go into the cache
+    tree->SetBranchStatus("*", 0);
+    for(int i = 0; i < nCol; i++){
+      TBranch *br = tree->GetBranch(names[i]);
+      TLeaf *leaf = br ? (TLeaf*)br->GetListOfLeaves()->At(0) : 0;
+      if(!leaf){
+        std::cout << "ERROR: no branch " << names[i] << " in the ntp1 tree" << std::endl;
+        delete file;
+        return kFALSE;
+      }
+      leafTypes[i] = leaf->GetTypeName();
+      tree->SetBranchStatus(names[i], 1);
+      if(leafTypes[i] == "Double_t")     tree->SetBranchAddress(names[i], &dbuf[i]);
+      else if(leafTypes[i] == "Float_t") tree->SetBranchAddress(names[i], &fbuf[i]);
+      else if(leafTypes[i] == "Int_t")   tree->SetBranchAddress(names[i], &ibuf[i]);
+      else{
+        std::cout << "ERROR: branch " << names[i] << " has unsupported type " << leafTypes[i] << std::endl;
+        delete file;
+        return kFALSE;
+      }
+      if(types[i] == kInt8 && leafTypes[i] != "Int_t"){
+        std::cout << "ERROR: branch " << names[i] << " is not an integer branch" << std::endl;
+        delete file;
+        return kFALSE;
+      }
+      if(types[i] == kFloat) fcol[i].resize(n);
+      else icol[i].resize(n);
+    }
+
+    for(Long64_t ievt = 0; ievt < n; ievt++){
+      tree->GetEntry(ievt);
+      for(int i = 0; i < nCol; i++){
+        if(types[i] == kInt8)              icol[i][ievt] = (Char_t)ibuf[i];   // labels, they fit in 8 bits
+        else if(leafTypes[i] == "Double_t") fcol[i][ievt] = (Float_t)dbuf[i];
+        else if(leafTypes[i] == "Float_t") fcol[i][ievt] = fbuf[i];
+        else                               fcol[i][ievt] = (Float_t)ibuf[i];
+      }
+    }
+    delete file;
+
+    std::vector<const void*> data(nCol);
+    for(int i = 0; i < nCol; i++) data[i] = (types[i] == kFloat) ? (const void*)fcol[i].data() : (const void*)icol[i].data();
+    return WriteFile(cacheFile, key, n, names, types, data);
+  }
+
+  // Write a cache file with the given columns of n entries each
+  static Bool_t WriteFile(const TString &path, const TString &key, Long64_t n, const std::vector<TString> &names,
+			  const std::vector<Int_t> &types, const std::vector<const void*> &data){
+    Int_t nCol = (Int_t)names.size();
+
+    // Header, column table, then the columns, each aligned to 64 bytes
+    Header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, Magic(), sizeof(h.magic));
+    h.version = kVersion;
+    h.nColumns = nCol;
+    h.nEntries = n;
+    strncpy(h.key, key.Data(), sizeof(h.key) - 1);
+    std::vector<ColumnDesc> desc(nCol);
+    Long64_t offset = Align(sizeof(Header) + nCol * sizeof(ColumnDesc));
+    for(int i = 0; i < nCol; i++){
+      memset(&desc[i], 0, sizeof(ColumnDesc));
+      strncpy(desc[i].name, names[i].Data(), sizeof(desc[i].name) - 1);
+      desc[i].type = types[i];
+      desc[i].offset = offset;
+      offset = Align(offset + n * TypeSize(types[i]));
+    }
+
+    // write to a temporary file of our own and move it in place, so that a crash never leaves a broken
+    // cache and jobs writing the same cache at once do not mix their files
+    std::vector<char> tmpName(path.Length() + 8);
+    snprintf(tmpName.data(), tmpName.size(), "%s.XXXXXX", path.Data());
+    int fd = mkstemp(tmpName.data());
+    TString tmpFile = tmpName.data();
+    FILE *out = (fd >= 0) ? fdopen(fd, "wb") : 0;
+    if(!out){
+      std::cout << "ERROR: could not write cache file " << tmpFile << std::endl;
+      if(fd >= 0){
+        close(fd);
+        remove(tmpFile);
+      }
+      return kFALSE;
+    }
+    fchmod(fd, 0644);    // mkstemp makes it private
+    Bool_t ok = fwrite(&h, sizeof(h), 1, out) == 1;
+    if(nCol > 0) ok = ok && fwrite(desc.data(), sizeof(ColumnDesc), nCol, out) == (size_t)nCol;
+    for(int i = 0; i < nCol && ok; i++){
+      ok = fseek(out, desc[i].offset, SEEK_SET) == 0;
+      ok = ok && fwrite(data[i], TypeSize(types[i]), n, out) == (size_t)n;
+    }
+    ok = (fclose(out) == 0) && ok;
+    if(!ok || rename(tmpFile, path) != 0){
+      std::cout << "ERROR: could not write cache file " << path << std::endl;
+      remove(tmpFile);
+      return kFALSE;
+    }
+    return kTRUE;
+  }
+
+  // Map an existing cache file, only if it was written with the given key
+  Bool_t OpenFile(const TString &path, const TString &key){
+    Close();
+    if(!Map(path)) return kFALSE;
+    if(fKey != key){
+      Close();
+      return kFALSE;
+    }
+    return kTRUE;
+  }
+
+private:
+  struct Header { char magic[8]; Int_t version; Int_t nColumns; Long64_t nEntries; char key[1024]; };
+  struct ColumnDesc { char name[56]; Int_t type; Int_t pad; Long64_t offset; };
+  struct Col { TString name; Int_t type; Long64_t offset; };
+  struct Derived { TString name; Float_t *data; size_t size; };
+
+  static const char *Magic(){ return "HEPMLFC"; }
+  static const Int_t kVersion = 1;
+
+  static Long64_t Align(Long64_t x){ return (x + 63) / 64 * 64; }
+  static Int_t TypeSize(Int_t type){
+    if(type == kFloat) return sizeof(Float_t);
+    if(type == kDouble) return sizeof(Double_t);
+    return sizeof(Char_t);
+  }
+
+  // Map the cache file and read its header; kFALSE if it does not exist or is not a valid cache
+  Bool_t Map(const TString &path){
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) return kFALSE;
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(Header)){
+      close(fd);
+      return kFALSE;
+    }
+    void *data = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) return kFALSE;
+    fData = (char*)data;
+    fSize = st.st_size;
+
+    const Header *h = (const Header*)fData;
+    if(memcmp(h->magic, Magic(), sizeof(h->magic)) != 0 || h->version != kVersion ||
+       sizeof(Header) + h->nColumns * sizeof(ColumnDesc) > fSize){
+      Close();
+      return kFALSE;
+    }
+    const ColumnDesc *desc = (const ColumnDesc*)(fData + sizeof(Header));
+    for(int i = 0; i < h->nColumns; i++){
+      if(desc[i].offset + h->nEntries * TypeSize(desc[i].type) > (Long64_t)fSize){
+        Close();
+        return kFALSE;
+      }
+      fColumns.push_back(Col{desc[i].name, desc[i].type, desc[i].offset});
+    }
+    fEntries = h->nEntries;
+    fKey = h->key;
+    return kTRUE;
+  }
+
+  // Name and type of a requested column, "name" (float) or "name/B" (int8)
+  static void ParseColumn(const TString &column, TString &name, Int_t &type){
+    type = column.EndsWith("/B") ? kInt8 : kFloat;
+    name = (type == kInt8) ? TString(column(0, column.Length() - 2)) : column;
+  }
+
+  // Add the columns of the mapped cache that are not in toBuild, so that a rebuild keeps them
+  // (but not those of another type than the ntp1 columns, they are rebuilt if asked for)
+  void KeepColumns(std::vector<TString> &toBuild) const {
+    for(auto &c : fColumns){
+      if(c.type != kFloat && c.type != kInt8) continue;
+      Bool_t found = kFALSE;
+      for(auto &column : toBuild){
+        TString name;
+        Int_t type;
+        ParseColumn(column, name, type);
+        if(name == c.name) found = kTRUE;
+      }
+      if(!found) toBuild.push_back((c.type == kInt8) ? c.name + "/B" : c.name);
+    }
+  }
+
+  // A column with the right name but another type counts as missing
+  Bool_t HasColumns(const std::vector<TString> &columns, Bool_t verbose) const {
+    for(auto &column : columns){
+      TString name;
+      Int_t type;
+      ParseColumn(column, name, type);
+      Bool_t found = kFALSE, otherType = kFALSE;
+      for(auto &c : fColumns){
+        if(c.name == name && c.type == type) found = kTRUE;
+        if(c.name == name && c.type != type) otherType = kTRUE;
+      }
+      if(!found){
+        if(verbose && otherType) std::cout << "ERROR: column " << name << " has another type in the feature cache" << std::endl;
+        else if(verbose) std::cout << "ERROR: column " << name << " is not in the feature cache" << std::endl;
+        return kFALSE;
+      }
+    }
+    return kTRUE;
+  }
+
+  const void *Column(const char *name, Int_t type) const {
+    for(auto &c : fColumns){
+      if(c.name == name && c.type == type) return fData + c.offset;
+    }
+    for(auto &d : fDerived){
+      if(d.name == name && type == kFloat) return d.data;
+    }
+    return 0;
+  }
+
+  char *fData;
+  size_t fSize;
+  Long64_t fEntries;
+  TString fKey;
+  std::vector<Col> fColumns;
+  std::vector<Derived> fDerived;
+};
+
+#endif
@@ -0,0 +1,118 @@
+/*
+Four-vector kernels over whole columns of events (structure of arrays).
+
+A particle is given by the columns of its four-momentum components, as they are in the feature cache
+(P4Columns::Of(input, "if4CPp") for if4CPp_px, ..., if4CPp_e). A kernel computes a quantity of the sum
+of some particles (its invariant mass, or the missing mass in the decay of a parent at rest) for a
+range of events at once, e.g. in cl.C
+
+  Kinematics::Mass({pp, pm, gamma}, 0, n, comEn);              // sqrt_s of p pbar gamma
+  Kinematics::MissingMass({pp, pm}, 0, n, missM, mJPsi);       // recoil against a J/psi at rest
+
+The events are processed in blocks: the components of the particles are first summed into arrays for
+the block, then the quantity is computed from the sums, in double precision. The sums are left to the
+auto-vectoriser; at -O2 it leaves these loops scalar, so with gcc the kernels are compiled at -O3
+whatever the ACLiC flags are (pragma below). A sqrt() loop is not vectorised unless the compiler is
+given -fno-math-errno, which a pragma cannot do, so the square root is written with SSE2 or AVX
+intrinsics on x86 (SSE2 is always there on x86-64). Elsewhere it is a plain loop, vectorised when
+compiled with e.g.
+
+  gSystem -> SetFlagsOpt("-O3 -fno-math-errno");    // then .L cl.C+O
+
+Where the squared mass is negative (a badly measured event) the square root is NaN, as it was in the
+old event-by-event functions.
+
+The results can be added to a FeatureCache as extra columns (FeatureCache::AddFloat), to be used as
+MVA inputs like the ntp1 branches.
+*/
+
+#ifndef KINEMATICS_H
+#define KINEMATICS_H
+
+#include <cmath>
+#include <vector>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include "TString.h"
+
+#include "FeatureCache.h"
+
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC optimize("O3")
+#endif
+
+
+// The four-momentum columns of a particle
+struct P4Columns {
+  const Float_t *px, *py, *pz, *e;
+
+  // The columns <prefix>_px, _py, _pz and _e of a feature cache (0 where missing)
+  static P4Columns Of(const FeatureCache &input, const TString &prefix){
+    return P4Columns{input.GetFloat(prefix + "_px"), input.GetFloat(prefix + "_py"),
+                     input.GetFloat(prefix + "_pz"), input.GetFloat(prefix + "_e")};
+  }
+};
+
+
+class Kinematics {
+
+public:
+  static const Int_t kBlock = 256;
+
+  // Invariant mass of the sum of the particles for the events [first, first + n), NaN where the
+  // squared mass is negative. eShift is subtracted from the total energy (see MissingMass).
+  template<class T>
+  static void Mass(const std::vector<P4Columns> &parts, Long64_t first, Long64_t n, T *out, Double_t eShift = 0){
+    Double_t sx[kBlock], sy[kBlock], sz[kBlock], se[kBlock];
+    for(Long64_t start = 0; start < n; start += kBlock){
+      const Int_t nb = (n - start < kBlock) ? (Int_t)(n - start) : kBlock;
+      // sum the four-momenta of the particles for the block
+      for(int i = 0; i < nb; i++){
+        sx[i] = sy[i] = sz[i] = 0;
+        se[i] = -eShift;
+      }
+      for(auto &p : parts){
+        const Float_t *px = p.px + first + start, *py = p.py + first + start;
+        const Float_t *pz = p.pz + first + start, *e = p.e + first + start;
+        for(int i = 0; i < nb; i++){
+          sx[i] += px[i];
+          sy[i] += py[i];
+          sz[i] += pz[i];
+          se[i] += e[i];
+        }
+      }
+      for(int i = 0; i < nb; i++) se[i] = se[i] * se[i] - (sx[i] * sx[i] + sy[i] * sy[i] + sz[i] * sz[i]);
+      Sqrt(se, nb);
+      T *o = out + start;
+      for(int i = 0; i < nb; i++) o[i] = (T)se[i];
+    }
+  }
+
+  // Missing mass of the particles in the decay of a parent of mass mParent at rest (e.g. the J/psi
+  // made in the e+ e- collision), i.e. the mass of (mParent, 0) minus their sum
+  template<class T>
+  static void MissingMass(const std::vector<P4Columns> &parts, Long64_t first, Long64_t n, T *out, Double_t mParent){
+    Mass(parts, first, n, out, mParent);
+  }
+
+private:
+  // x[i] = sqrt(x[i]), NaN for negative x[i]
+  static void Sqrt(Double_t *x, Int_t n){
+    Int_t i = 0;
+#if defined(__AVX__)
+    for(; i + 4 <= n; i += 4) _mm256_storeu_pd(x + i, _mm256_sqrt_pd(_mm256_loadu_pd(x + i)));
+#elif defined(__SSE2__)
+    for(; i + 2 <= n; i += 2) _mm_storeu_pd(x + i, _mm_sqrt_pd(_mm_loadu_pd(x + i)));
+#endif
+    for(; i < n; i++) x[i] = std::sqrt(x[i]);
+  }
+};
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC pop_options
+#endif
+
+#endif
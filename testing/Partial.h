@@ -0,0 +1,147 @@
+/*
+Partial results of the scan macros (chisq_scan.C, energy_scan.C, cl.C), to run them as map-reduce jobs.
+
+Given a partial output file, a macro only fills its counters for its input file or entry range and
+writes them there: the scanners (CutScan::Write, WindowScan::Write), the cut-independent control
+histograms and the totals, tagged with the name of the macro and its configuration. merge.C adds any
+number of partial files into one, which is again a partial result, and a macro given a partial result
+as input runs the optimisation and the report on the merged counters instead of reading events.
+
+When merging, every object of the files is added (TVectorD and TH1), except for:
+  *_grid : the cut grids, which must be the same in all the files
+  TNamed : the name of the macro and its configuration, which must be the same as well
+*/
+
+#ifndef PARTIAL_H
+#define PARTIAL_H
+
+#include <vector>
+#include <iostream>
+#include "TString.h"
+#include "TSystem.h"
+#include "TFile.h"
+#include "TKey.h"
+#include "TNamed.h"
+#include "TVectorD.h"
+#include "TH1.h"
+
+
+class Partial {
+
+public:
+  // Name of the macro that wrote the partial result in file, "" if the file is not a partial result
+  static TString Kind(const TString &file){
+    if(!file.EndsWith(".root") || gSystem -> AccessPathName(file)) return "";
+    TFile *f = TFile::Open(file);
+    if(!f) return "";
+    TNamed *tag = (TNamed*)f -> Get("partial");
+    TString kind = tag ? tag -> GetTitle() : "";
+    delete tag;
+    delete f;
+    return kind;
+  }
+
+  // Create a partial result file of the macro kind, with its configuration (anything the counters
+  // depend on besides the cut grids). The file is the current directory on return.
+  static TFile *Create(const TString &file, const char *kind, const TString &config){
+    TFile *f = TFile::Open(file, "RECREATE");
+    if(!f || f -> IsZombie()){
+      std::cout << "ERROR: could not create partial result file " << file << std::endl;
+      return 0;
+    }
+    TNamed("partial", kind).Write("partial");
+    TNamed("config", config).Write("config");
+    return f;
+  }
+
+  // Open a partial result file of the macro kind, made with the same configuration. Returns 0 (and
+  // prints why) if it is not one.
+  static TFile *Open(const TString &file, const char *kind, const TString &config){
+    TFile *f = TFile::Open(file);
+    TNamed *tag = f ? (TNamed*)f -> Get("partial") : 0;
+    TNamed *conf = f ? (TNamed*)f -> Get("config") : 0;
+    Bool_t ok = tag && conf && TString(tag -> GetTitle()) == kind;
+    if(!ok) std::cout << "ERROR: " << file << " is not a partial result of " << kind << std::endl;
+    else if(config != conf -> GetTitle()){
+      std::cout << "ERROR: " << file << " was made with a different configuration:\n  " << conf -> GetTitle()
+                << "\ninstead of\n  " << config << std::endl;
+      ok = kFALSE;
+    }
+    delete tag;
+    delete conf;
+    if(!ok){
+      delete f;
+      return 0;
+    }
+    return f;
+  }
+
+  // Add the partial results in the input files and write the sums to output. Returns kFALSE (and
+  // prints why) if they cannot be merged.
+  static Bool_t Merge(const std::vector<TString> &inputs, const TString &output){
+    if(inputs.empty()){
+      std::cout << "ERROR: no partial results to merge" << std::endl;
+      return kFALSE;
+    }
+    // the objects of the first file are the accumulators
+    std::vector<TString> names;
+    std::vector<TObject*> sums;
+    Bool_t ok = (Kind(inputs[0]) != "");
+    TFile *f = ok ? TFile::Open(inputs[0]) : 0;
+    if(f){
+      TIter next(f -> GetListOfKeys());
+      while(TKey *key = (TKey*)next()){
+        TObject *obj = key -> ReadObj();
+        if(obj -> InheritsFrom(TH1::Class())) ((TH1*)obj) -> SetDirectory(0);
+        names.push_back(key -> GetName());
+        sums.push_back(obj);
+      }
+      delete f;
+    }
+    if(!ok) std::cout << "ERROR: " << inputs[0] << " is not a partial result" << std::endl;
+
+    for(size_t i = 1; ok && i < inputs.size(); i++){
+      f = TFile::Open(inputs[i]);
+      ok = f && f -> GetListOfKeys() -> GetSize() == (Int_t)sums.size();
+      for(size_t j = 0; ok && j < sums.size(); j++){
+        TObject *obj = f -> Get(names[j]);
+        ok = obj && obj -> IsA() == sums[j] -> IsA();
+        if(ok) ok = Add(names[j], sums[j], obj);
+        if(obj && !obj -> InheritsFrom(TH1::Class())) delete obj;    // histograms belong to the file
+      }
+      if(!ok) std::cout << "ERROR: " << inputs[i] << " does not match " << inputs[0] << " (macro, configuration or cut grids)" << std::endl;
+      delete f;
+    }
+
+    if(ok){
+      TFile *out = TFile::Open(output, "RECREATE");
+      ok = out && !out -> IsZombie();
+      for(size_t j = 0; ok && j < sums.size(); j++) sums[j] -> Write(names[j]);
+      if(ok) std::cout << "--- Merged " << inputs.size() << " partial results into " << output << std::endl;
+      else std::cout << "ERROR: could not create " << output << std::endl;
+      delete out;
+    }
+    for(auto *obj : sums) delete obj;
+    return ok;
+  }
+
+private:
+  // Add a partial result object to the accumulator of the same name
+  static Bool_t Add(const TString &name, TObject *sum, TObject *obj){
+    if(obj -> InheritsFrom(TH1::Class())) return ((TH1*)sum) -> Add((TH1*)obj);
+    if(obj -> InheritsFrom(TNamed::Class())) return TString(obj -> GetTitle()) == sum -> GetTitle();
+    if(obj -> InheritsFrom(TVectorD::Class())){
+      TVectorD &s = *(TVectorD*)sum, &v = *(TVectorD*)obj;
+      if(v.GetNrows() != s.GetNrows()) return kFALSE;
+      if(name.EndsWith("_grid")){
+        for(int i = 0; i < v.GetNrows(); i++) if(v[i] != s[i]) return kFALSE;
+        return kTRUE;
+      }
+      s += v;
+      return kTRUE;
+    }
+    return kFALSE;
+  }
+};
+
+#endif
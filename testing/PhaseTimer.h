@@ -0,0 +1,84 @@
+/*
+Phase timer for the throughput measurements of the macros (see benchmark.C).
+
+A macro marks the start of each of its phases (io, scan, inference, kinematics, fill); the time until
+the next mark is added to that phase, so a phase can be entered several times. Report() prints the
+phases and, if the environment variable HEPML_BENCH_JSON is set, appends them to that file as one
+JSON line:
+
+  {"macro": "chisq_scan", "events": 1000000, "total_s": 1.92, "events_per_s": 520833, "phases": {"io": 0.41, ...}}
+
+The timer reports by itself when it goes out of scope, if the macro did not (early returns).
+*/
+
+#ifndef PHASETIMER_H
+#define PHASETIMER_H
+
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include "TString.h"
+#include "TSystem.h"
+#include "TStopwatch.h"
+
+
+class PhaseTimer {
+
+public:
+  PhaseTimer(const char *macro) : fMacro(macro), fEvents(0), fCurrent(-1), fReported(kFALSE) { fTotal.Start(); }
+  ~PhaseTimer(){ if(!fReported) Report(); }
+
+  // Close the current phase and start (or resume) the given one
+  void Start(const char *phase){
+    Stop();
+    for(size_t i = 0; i < fPhases.size() && fCurrent < 0; i++) if(fPhases[i] == phase) fCurrent = (Int_t)i;
+    if(fCurrent < 0){
+      fPhases.push_back(phase);
+      fWatches.push_back(TStopwatch());
+      fCurrent = (Int_t)fPhases.size() - 1;
+    }
+    fWatches[fCurrent].Start(kFALSE);
+  }
+
+  // Close the current phase; the time until the next Start() is not assigned to any phase
+  void Stop(){
+    if(fCurrent >= 0) fWatches[fCurrent].Stop();
+    fCurrent = -1;
+  }
+
+  // Number of events processed, for the throughput
+  void SetEvents(Long64_t n){ fEvents = n; }
+
+  void Report(){
+    Stop();
+    fTotal.Stop();
+    fReported = kTRUE;
+    Double_t total = fTotal.RealTime();
+    Double_t rate = (total > 0) ? fEvents / total : 0;
+
+    std::cout << "--- " << fMacro << " timing:";
+    for(size_t i = 0; i < fPhases.size(); i++) std::cout << " " << fPhases[i] << " " << fWatches[i].RealTime() << " s,";
+    std::cout << " total " << total << " s for " << fEvents << " events (" << rate << " events/s)" << std::endl;
+
+    const char *jsonFile = gSystem -> Getenv("HEPML_BENCH_JSON");
+    if(!jsonFile || !*jsonFile) return;
+    std::ofstream out(jsonFile, std::ios::app);
+    out << "{\"macro\": \"" << fMacro << "\", \"events\": " << fEvents << ", \"total_s\": " << total
+        << ", \"events_per_s\": " << rate << ", \"phases\": {";
+    for(size_t i = 0; i < fPhases.size(); i++){
+      out << (i ? ", " : "") << "\"" << fPhases[i] << "\": " << fWatches[i].RealTime();
+    }
+    out << "}}" << std::endl;
+  }
+
+private:
+  TString fMacro;
+  Long64_t fEvents;
+  Int_t fCurrent;
+  Bool_t fReported;
+  std::vector<TString> fPhases;
+  std::vector<TStopwatch> fWatches;
+  TStopwatch fTotal;
+};
+
+#endif
@@ -0,0 +1,70 @@
+/*
+Sidecar file with the per-event output of one MVA method, so that cl.C evaluates each event only once:
+the scores of the first event loop are reused in the second one, and on later runs with the same
+weights and the same input they are read back instead of running the inference again.
+
+The sidecar uses the feature cache file format with a single Double_t column, and is keyed by the
+identity of the input file, the MD5 of the weights XML and the feature space. If any of them changes
+the scores are recomputed.
+*/
+
+#ifndef SCORECACHE_H
+#define SCORECACHE_H
+
+#include <vector>
+#include "TString.h"
+#include "TSystem.h"
+#include "TMD5.h"
+
+#include "FeatureCache.h"
+
+
+class ScoreCache {
+
+public:
+  ScoreCache() : fScores(0) {}
+
+  // Sidecar file for the scores of a method on an input file, in the working directory (named like the
+  // feature cache, see FeatureCache::DefaultPath)
+  static TString Path(const TString &input, const TString &method){
+    return TString("./") + gSystem->BaseName(input) + "." + FeatureCache::PathHash(input) + "." + method + ".scores";
+  }
+
+  // Key of the scores; empty if the input or the weights file cannot be read, which disables the cache
+  static TString Key(const TString &input, const TString &weights, Int_t featSpace){
+    TString inputKey = FeatureCache::InputKey(input), md5 = WeightsMD5(weights);
+    if(inputKey == "" || md5 == "") return "";
+    return TString::Format("%s:%s:%d", inputKey.Data(), md5.Data(), featSpace);
+  }
+
+  // MD5 of a weights file, empty if it cannot be read
+  static TString WeightsMD5(const TString &weights){
+    TMD5 *md5 = TMD5::FileChecksum(weights);
+    if(!md5) return "";
+    TString sum = md5->AsString();
+    delete md5;
+    return sum;
+  }
+
+  // Map the scores if the sidecar exists, has the given key and the expected number of entries
+  Bool_t Open(const TString &path, const TString &key, Long64_t nEntries){
+    fScores = 0;
+    if(key == "" || !fFile.OpenFile(path, key)) return kFALSE;
+    if(fFile.GetEntries() != nEntries) return kFALSE;
+    fScores = fFile.GetDouble("score");
+    return fScores != 0;
+  }
+
+  const Double_t *GetScores() const { return fScores; }
+
+  static Bool_t Write(const TString &path, const TString &key, const std::vector<Double_t> &scores){
+    if(key == "") return kFALSE;
+    return FeatureCache::WriteFile(path, key, (Long64_t)scores.size(), {"score"}, {FeatureCache::kDouble}, {scores.data()});
+  }
+
+private:
+  FeatureCache fFile;
+  const Double_t *fScores;
+};
+
+#endif
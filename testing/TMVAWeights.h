@@ -0,0 +1,128 @@
+/*
+Reader for the TMVA weights XML files (TMVAfactory_*.weights.xml), shared by the native MVA evaluators
+(MLPEvaluator.h, BDTCompiler.h). It gives access to the method options, the input variables and the
+Normalize input transformation, and to the <Weights> node the evaluators parse themselves.
+
+Only what the trainings in this repository use is supported: no transformation or a single Normalize
+transformation over all the input variables.
+*/
+
+#ifndef TMVAWEIGHTS_H
+#define TMVAWEIGHTS_H
+
+#include <vector>
+#include <iostream>
+#include "TString.h"
+#include "TXMLEngine.h"
+
+
+class TMVAWeights {
+
+public:
+  TMVAWeights() : fDoc(0), fRoot(0), fWeights(0) {}
+  ~TMVAWeights(){ if(fDoc) fXML.FreeDoc(fDoc); }
+
+  // Parse the weights file. Returns kFALSE (and prints why) if it cannot be used.
+  Bool_t Load(const TString &file){
+    fDoc = fXML.ParseFile(file);
+    if(!fDoc){
+      std::cout << "ERROR: could not parse weights file " << file << std::endl;
+      return kFALSE;
+    }
+    fRoot = fXML.DocGetRootElement(fDoc);
+    fMethod = Attr(fRoot, "Method");     // e.g. "MLP::ANN"
+
+    XMLNodePointer_t node = Child(Child(fRoot, "GeneralInfo"), 0);
+    for(; node; node = fXML.GetNext(node)){
+      if(Attr(node, "name") == "AnalysisType") fAnalysisType = Attr(node, "value");
+    }
+    for(node = Child(Child(fRoot, "Options"), 0); node; node = fXML.GetNext(node)){
+      fOptionNames.push_back(Attr(node, "name"));
+      fOptionValues.push_back(fXML.GetNodeContent(node) ? fXML.GetNodeContent(node) : "");
+    }
+    for(node = Child(Child(fRoot, "Variables"), 0); node; node = fXML.GetNext(node)){
+      fVariables.push_back(Attr(node, "Expression"));
+    }
+
+    fWeights = Child(fRoot, "Weights");
+    if(!fWeights){
+      std::cout << "ERROR: no Weights in " << file << std::endl;
+      return kFALSE;
+    }
+    return LoadTransformation(file);
+  }
+
+  const TString &GetMethod() const { return fMethod; }
+  const TString &GetAnalysisType() const { return fAnalysisType; }
+  const std::vector<TString> &GetVariables() const { return fVariables; }
+  Int_t GetNVariables() const { return (Int_t)fVariables.size(); }
+
+  // Value of a method option, or def if it is not in the file
+  TString GetOption(const char *name, const char *def = "") const {
+    for(size_t i = 0; i < fOptionNames.size(); i++){
+      if(fOptionNames[i] == name) return fOptionValues[i];
+    }
+    return def;
+  }
+
+  // The Normalize transformation maps each input to (x - min) / (max - min) * 2 - 1, as TMVA does
+  Bool_t HasNormalize() const { return !fMin.empty(); }
+  Float_t GetMin(Int_t i) const { return fMin[i]; }
+  Float_t GetScale(Int_t i) const { return fScale[i]; }
+
+  TXMLEngine &Engine() { return fXML; }
+  XMLNodePointer_t GetWeightsNode() const { return fWeights; }
+
+  // XML helpers: the first child called name (any child if name is 0), and an attribute as a string
+  XMLNodePointer_t Child(XMLNodePointer_t node, const char *name){
+    if(!node) return 0;
+    for(XMLNodePointer_t c = fXML.GetChild(node); c; c = fXML.GetNext(c)){
+      if(!name || TString(fXML.GetNodeName(c)) == name) return c;
+    }
+    return 0;
+  }
+  TString Attr(XMLNodePointer_t node, const char *name){
+    const char *value = node ? fXML.GetAttr(node, name) : 0;
+    return value ? value : "";
+  }
+
+private:
+  Bool_t LoadTransformation(const TString &file){
+    XMLNodePointer_t trafos = Child(fRoot, "Transformations");
+    Int_t nTrafo = trafos ? Attr(trafos, "NTransformations").Atoi() : 0;
+    if(nTrafo == 0) return kTRUE;
+    XMLNodePointer_t trafo = Child(trafos, "Transform");
+    if(nTrafo > 1 || Attr(trafo, "Name") != "Normalize"){
+      std::cout << "ERROR: unsupported input transformation in " << file << " (only Normalize is supported)" << std::endl;
+      return kFALSE;
+    }
+
+    // TMVA uses the ranges of the last class (all classes together) when applying the transformation
+    XMLNodePointer_t cls = 0;
+    for(XMLNodePointer_t c = Child(trafo, "Class"); c; c = fXML.GetNext(c)){
+      if(TString(fXML.GetNodeName(c)) == "Class") cls = c;
+    }
+    XMLNodePointer_t ranges = Child(cls, "Ranges");
+    for(XMLNodePointer_t r = Child(ranges, "Range"); r; r = fXML.GetNext(r)){
+      Float_t min = (Float_t)Attr(r, "Min").Atof();
+      Float_t max = (Float_t)Attr(r, "Max").Atof();
+      fMin.push_back(min);
+      fScale.push_back((Float_t)(1.0 / (max - min)));
+    }
+    if((Int_t)fMin.size() != GetNVariables()){
+      std::cout << "ERROR: the Normalize transformation in " << file << " does not cover all the variables" << std::endl;
+      return kFALSE;
+    }
+    return kTRUE;
+  }
+
+  TXMLEngine fXML;
+  XMLDocPointer_t fDoc;
+  XMLNodePointer_t fRoot, fWeights;
+  TString fMethod, fAnalysisType;
+  std::vector<TString> fOptionNames, fOptionValues;
+  std::vector<TString> fVariables;
+  std::vector<Float_t> fMin, fScale;
+};
+
+#endif
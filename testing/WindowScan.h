@@ -0,0 +1,198 @@
+/*
+Window optimizer for the sqrt_s interval scans (energy_scan.C) and the joint sqrt_s x chisq4C
+selection (twodim.C).
+
+The events are filled once into a 2-D signal/background histogram whose bins are the "slots" of the
+cut grids, i.e. the open intervals between consecutive cut values and the cut values themselves, so
+that strict inequalities are reproduced exactly. A summed-area table is then built on top of it and the
+counts for any window cutLeft[l] < sqrt_s < cutRight[r], optionally with chisq4C < chiCuts[c], are read
+off in O(1). Scoring every window (and every window x chisq cut) is O(grid) instead of O(events x grid).
+
+As for CutScan, the histograms can be written to a ROOT file and added back from it, to merge the
+partial results of separate jobs (see Partial.h).
+*/
+
+#ifndef WINDOWSCAN_H
+#define WINDOWSCAN_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include "RtypesCore.h"
+#include "TString.h"
+#include "TDirectory.h"
+#include "TVectorD.h"
+
+#include "CutScan.h"
+
+
+class WindowScan {
+
+public:
+  // All cut arrays must be sorted in ascending order. Without chisq cuts only the window is scanned.
+  WindowScan(const Double_t *left, Int_t nLeft, const Double_t *right, Int_t nRight, const Double_t *chiCuts = 0, Int_t nChi = 0)
+    : fLeft(left, left + nLeft), fRight(right, right + nRight), fChi(chiCuts, chiCuts + nChi), fTotS(0), fTotB(0) {
+    // the sqrt_s grid is the union of the left and the right edges
+    fEdges = fLeft;
+    fEdges.insert(fEdges.end(), fRight.begin(), fRight.end());
+    std::sort(fEdges.begin(), fEdges.end());
+    fEdges.erase(std::unique(fEdges.begin(), fEdges.end()), fEdges.end());
+    for(int l = 0; l < nLeft; l++)  fIdxL.push_back((Int_t)(std::lower_bound(fEdges.begin(), fEdges.end(), left[l]) - fEdges.begin()));
+    for(int r = 0; r < nRight; r++) fIdxR.push_back((Int_t)(std::lower_bound(fEdges.begin(), fEdges.end(), right[r]) - fEdges.begin()));
+
+    fNE = 2 * (Int_t)fEdges.size() + 1;
+    fNC = 2 * nChi + 2;    // the last chisq slot holds NaN values, which never pass a chisq cut
+    fSumS.assign((fNE + 1) * (fNC + 1), 0);
+    fSumB.assign((fNE + 1) * (fNC + 1), 0);
+  }
+
+  // Add one event; signal is the mcSignal label (1 = signal, 0 = background, anything else is ignored)
+  void Fill(Double_t energy, Double_t chi, Int_t signal){
+    if(signal != 0 && signal != 1) return;
+    Int_t e = std::isnan(energy) ? 0 : Slot(fEdges, energy);
+    Int_t c = std::isnan(chi) ? fNC - 1 : Slot(fChi, chi);
+    // the histogram lives in the summed-area table storage, shifted by one row and column
+    if(signal == 1){ fSumS[(e + 1) * (fNC + 1) + c + 1]++; fTotS++; }
+    else           { fSumB[(e + 1) * (fNC + 1) + c + 1]++; fTotB++; }
+  }
+  void Fill(Double_t energy, Int_t signal){ Fill(energy, 0, signal); }
+
+  // Write the cut grids and the histograms to the current directory as name_grid and name_counts.
+  // Call before Finalize().
+  void Write(const char *name) const {
+    TVectorD grid = Grid();
+    Int_t size = (fNE + 1) * (fNC + 1);
+    TVectorD counts(2 * size + 2);
+    for(int i = 0; i < size; i++){
+      counts[i] = fSumS[i];
+      counts[size + i] = fSumB[i];
+    }
+    counts[2 * size] = fTotS;
+    counts[2 * size + 1] = fTotB;
+    grid.Write(TString(name) + "_grid");
+    counts.Write(TString(name) + "_counts");
+  }
+
+  // Add the histograms written by Write() under name in dir. Returns kFALSE if they are missing or
+  // were made on different cut grids. Call before Finalize().
+  Bool_t Read(TDirectory *dir, const char *name){
+    TVectorD mine = Grid();
+    Int_t size = (fNE + 1) * (fNC + 1);
+    TVectorD *grid = (TVectorD*)dir -> Get(TString(name) + "_grid");
+    TVectorD *counts = (TVectorD*)dir -> Get(TString(name) + "_counts");
+    Bool_t ok = grid && counts && grid -> GetNrows() == mine.GetNrows() && counts -> GetNrows() == 2 * size + 2;
+    for(int i = 0; ok && i < mine.GetNrows(); i++) ok = ((*grid)[i] == mine[i]);
+    for(int i = 0; ok && i < size; i++){
+      fSumS[i] += (Long64_t)(*counts)[i];
+      fSumB[i] += (Long64_t)(*counts)[size + i];
+    }
+    if(ok){
+      fTotS += (Long64_t)(*counts)[2 * size];
+      fTotB += (Long64_t)(*counts)[2 * size + 1];
+    }
+    delete grid;
+    delete counts;
+    return ok;
+  }
+
+  // Turn the histograms into summed-area tables. Call once after the event loop.
+  void Finalize(){
+    Integrate(fSumS);
+    Integrate(fSumB);
+  }
+
+  Int_t    GetNLeft() const { return (Int_t)fLeft.size(); }
+  Int_t    GetNRight() const { return (Int_t)fRight.size(); }
+  Int_t    GetNChi() const { return (Int_t)fChi.size(); }
+  Double_t GetLeft(Int_t l) const { return fLeft[l]; }
+  Double_t GetRight(Int_t r) const { return fRight[r]; }
+  Double_t GetChi(Int_t c) const { return fChi[c]; }
+  Long64_t GetTotS() const { return fTotS; }
+  Long64_t GetTotB() const { return fTotB; }
+
+  // Events with cutLeft[l] < sqrt_s < cutRight[r] and, if c >= 0, chisq4C < chiCuts[c]
+  Long64_t GetS(Int_t l, Int_t r, Int_t c = -1) const { return Count(fSumS, l, r, c); }
+  Long64_t GetB(Int_t l, Int_t r, Int_t c = -1) const { return Count(fSumB, l, r, c); }
+
+  Double_t GetSignificance(Int_t l, Int_t r, Int_t c = -1) const { return CutScan::Significance(GetS(l, r, c), GetB(l, r, c)); }
+  Double_t GetSoverB(Int_t l, Int_t r, Int_t c = -1) const { return (Double_t)GetS(l, r, c) / (Double_t)GetB(l, r, c); }
+  Double_t GetSigEff(Int_t l, Int_t r, Int_t c = -1) const { return (Double_t)GetS(l, r, c) / (Double_t)fTotS; }
+  Double_t GetBkgRej(Int_t l, Int_t r, Int_t c = -1) const { return (Double_t)(fTotB - GetB(l, r, c)) / (Double_t)fTotB; }
+
+  // Best window (and chisq cut, -1 if there are none) by significance; on ties the first one in
+  // (l, r, c) order is kept. Returns the best significance.
+  Double_t FindBest(Int_t &bestL, Int_t &bestR, Int_t &bestC) const {
+    Double_t best = -1;
+    bestL = 0; bestR = 0; bestC = fChi.empty() ? -1 : 0;
+    for(int l = 0; l < GetNLeft(); l++){
+      for(int r = 0; r < GetNRight(); r++){
+        for(int c = fChi.empty() ? -1 : 0; c < GetNChi(); c++){
+          Double_t sig = GetSignificance(l, r, c);
+          if(sig > best){
+            best = sig;
+            bestL = l; bestR = r; bestC = c;
+          }
+        }
+      }
+    }
+    return best;
+  }
+
+  // Best chisq cut for a given window, -1 if there are no chisq cuts
+  Int_t BestChi(Int_t l, Int_t r) const {
+    Int_t bestC = -1;
+    Double_t best = -1;
+    for(int c = 0; c < GetNChi(); c++){
+      Double_t sig = GetSignificance(l, r, c);
+      if(sig > best){
+        best = sig;
+        bestC = c;
+      }
+    }
+    return bestC;
+  }
+
+private:
+  // Slot of a value on a grid of n cut values: 0 below the first cut, 2k+1 on cut k,
+  // 2k+2 between cut k and cut k+1 (or above the last one)
+  static Int_t Slot(const std::vector<Double_t> &grid, Double_t value){
+    Int_t k = (Int_t)(std::lower_bound(grid.begin(), grid.end(), value) - grid.begin());
+    if(k < (Int_t)grid.size() && grid[k] == value) return 2 * k + 1;
+    return 2 * k;
+  }
+
+  // The three cut grids, each preceded by its size
+  TVectorD Grid() const {
+    TVectorD grid((Int_t)(3 + fLeft.size() + fRight.size() + fChi.size()));
+    Int_t i = 0;
+    for(auto *v : {&fLeft, &fRight, &fChi}){
+      grid[i++] = v -> size();
+      for(Double_t x : *v) grid[i++] = x;
+    }
+    return grid;
+  }
+
+  void Integrate(std::vector<Long64_t> &t) const {
+    for(int e = 1; e <= fNE; e++){
+      for(int c = 1; c <= fNC; c++){
+        t[e * (fNC + 1) + c] += t[(e - 1) * (fNC + 1) + c] + t[e * (fNC + 1) + c - 1] - t[(e - 1) * (fNC + 1) + c - 1];
+      }
+    }
+  }
+
+  Long64_t Count(const std::vector<Long64_t> &t, Int_t l, Int_t r, Int_t c) const {
+    // sqrt_s slots strictly between the two edges, chisq slots strictly below the cut
+    Int_t eLo = 2 * fIdxL[l] + 2, eHi = 2 * fIdxR[r] + 1;   // [eLo, eHi) in slot units
+    if(eHi <= eLo) return 0;
+    Int_t cHi = (c < 0) ? fNC : 2 * c + 1;
+    return t[eHi * (fNC + 1) + cHi] - t[eLo * (fNC + 1) + cHi];
+  }
+
+  std::vector<Double_t> fLeft, fRight, fChi, fEdges;
+  std::vector<Int_t> fIdxL, fIdxR;        // position of the left/right cuts on the sqrt_s grid
+  Int_t fNE, fNC;                         // number of sqrt_s and chisq slots
+  std::vector<Long64_t> fSumS, fSumB;     // (fNE+1) x (fNC+1) summed-area tables
+  Long64_t fTotS, fTotB;
+};
+
+#endif